@@ -0,0 +1,372 @@
+//
+//  CompressedSeries.cpp
+//
+//  Code_Frontiers
+//  Copyright (C) 2018  Université de Lorraine - CNRS
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "CompressedSeries.h"
+#include <cmath>
+#include <cstring>
+
+/**
+ * Reads the bits of a Block in the order they were written
+ */
+class BitReader
+{
+public:
+    BitReader(const std::vector<uint64_t>& bits): m_bits(bits), m_position(0)
+    {
+    }
+    
+    uint64_t read(const unsigned int n)
+    {
+        uint64_t value = 0;
+        for(unsigned int i = 0; i < n; i++)
+        {
+            value = (value << 1) | ((m_bits[m_position >> 6] >> (63 - (m_position & 63))) & 1);
+            m_position++;
+        }
+        return value;
+    }
+    
+private:
+    const std::vector<uint64_t>& m_bits;
+    unsigned long m_position;
+};
+
+static uint32_t floatBits(const float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bitsFloat(const uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static int leadingZeros(uint32_t x)
+{
+    int n = 0;
+    while(!(x & 0x80000000u))
+    {
+        x <<= 1;
+        n++;
+    }
+    return n;
+}
+
+static int trailingZeros(uint32_t x)
+{
+    int n = 0;
+    while(!(x & 1))
+    {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Linear extrapolation of the next value, it is computed the same way when encoding and decoding
+ * @param previous bits of the value before the last one (uint32_t)
+ * @param last bits of the last value (uint32_t)
+ * @return bits of the predicted value (uint32_t)
+ */
+static uint32_t predict(const uint32_t previous, const uint32_t last)
+{
+    const float a = bitsFloat(previous), b = bitsFloat(last);
+    const float prediction = b + (b - a);
+    // Non finite values would contaminate the following predictions
+    if(!std::isfinite(prediction))
+        return last;
+    return floatBits(prediction);
+}
+
+/**
+ * Sign extends the n lowest bits of a value
+ */
+static int64_t signExtend(const uint64_t value, const unsigned int n)
+{
+    return (int64_t)(value << (64 - n)) >> (64 - n);
+}
+
+/**
+ * CompressedSeries Constructor
+ * @param resolution duration of a tick in seconds, timestamps are rounded to it (double)
+ * @param blockSize number of samples per block (unsigned int)
+ */
+CompressedSeries::CompressedSeries(const double resolution, const unsigned int blockSize): m_resolution(resolution),
+                                                                                           m_blockSize(blockSize), m_size(0),
+                                                                                           m_blocks(), m_delta(0), m_value(0), m_previous(0),
+                                                                                           m_leading(-1), m_trailing(0)
+{
+}
+
+/**
+ * Appends n bits to a Block, most significant first
+ */
+void CompressedSeries::write(Block& block, const uint64_t value, const unsigned int n)
+{
+    for(unsigned int i = n; i > 0; i--)
+    {
+        if((block.nbBits & 63) == 0)
+            block.bits.push_back(0);
+        block.bits.back() |= ((value >> (i - 1)) & 1) << (63 - (block.nbBits & 63));
+        block.nbBits++;
+    }
+}
+
+/**
+ * Appends a sample
+ * @param t time in seconds, must not be smaller than the previous one (double)
+ * @param value sample value (float)
+ */
+void CompressedSeries::push(const double t, const float value)
+{
+    const int64_t ticks = (int64_t)std::llround(t / m_resolution);
+    const uint32_t bits = floatBits(value);
+    
+    if(m_blocks.empty() || m_blocks.back().count == m_blockSize)
+    {
+        if(!m_blocks.empty())
+            m_blocks.back().bits.shrink_to_fit();
+        // The first sample of a block is stored as is
+        m_blocks.push_back(Block());
+        Block& block = m_blocks.back();
+        block.first = block.last = ticks;
+        block.count = 1;
+        block.nbBits = 0;
+        write(block, (uint64_t)ticks, 64);
+        write(block, bits, 32);
+        m_delta = 0;
+        m_value = bits;
+        m_previous = bits;
+        m_leading = -1;
+        m_trailing = 0;
+        m_size++;
+        return;
+    }
+    
+    Block& block = m_blocks.back();
+    
+    // Regularly sampled timestamps cost a single bit
+    const int64_t delta = ticks - block.last;
+    const int64_t dod = delta - m_delta;
+    if(dod == 0)
+        write(block, 0, 1);
+    else if(dod >= -64 && dod < 64)
+    {
+        write(block, 0x2, 2);
+        write(block, (uint64_t)dod, 7);
+    }
+    else if(dod >= -256 && dod < 256)
+    {
+        write(block, 0x6, 3);
+        write(block, (uint64_t)dod, 9);
+    }
+    else if(dod >= -2048 && dod < 2048)
+    {
+        write(block, 0xE, 4);
+        write(block, (uint64_t)dod, 12);
+    }
+    else
+    {
+        write(block, 0xF, 4);
+        write(block, (uint64_t)dod, 64);
+    }
+    m_delta = delta;
+    block.last = ticks;
+    
+    // Smooth signals are close to the linear extrapolation of the two previous values: they share its sign, exponent
+    // and high mantissa bits, so that only a few bits differ.
+    const uint32_t x = bits ^ predict(m_previous, m_value);
+    if(x == 0)
+        write(block, 0, 1);
+    else
+    {
+        int leading = leadingZeros(x);
+        const int trailing = trailingZeros(x);
+        if(leading > 31)
+            leading = 31;
+        // The previous window is reused when the meaningful bits fit in it, unless a new window is cheaper
+        if(m_leading != -1 && leading >= m_leading && trailing >= m_trailing
+           && 32 - m_leading - m_trailing <= 10 + 32 - leading - trailing)
+        {
+            write(block, 0x2, 2);
+            write(block, x >> m_trailing, 32 - m_leading - m_trailing);
+        }
+        else
+        {
+            const int meaningful = 32 - leading - trailing;
+            write(block, 0x3, 2);
+            write(block, leading, 5);
+            write(block, meaningful - 1, 5);
+            write(block, x >> trailing, meaningful);
+            m_leading = leading;
+            m_trailing = trailing;
+        }
+    }
+    m_previous = m_value;
+    m_value = bits;
+    block.count++;
+    m_size++;
+}
+
+unsigned long CompressedSeries::size() const
+{
+    return m_size;
+}
+
+/**
+ * Memory used by the encoded samples
+ * @return number of bytes (unsigned long)
+ */
+unsigned long CompressedSeries::memory() const
+{
+    unsigned long bytes = sizeof(*this);
+    for(const Block& block: m_blocks)
+        bytes += sizeof(Block) + block.bits.capacity() * sizeof(uint64_t);
+    return bytes;
+}
+
+unsigned int CompressedSeries::blocks() const
+{
+    return (unsigned int)m_blocks.size();
+}
+
+/**
+ * Finds the first block that ends at or after a given time
+ * @param t time in seconds (double)
+ * @return block index, blocks() if every block ends before t (unsigned int)
+ */
+unsigned int CompressedSeries::findBlock(const double t) const
+{
+    const int64_t ticks = (int64_t)std::floor(t / m_resolution);
+    unsigned int low = 0, high = blocks();
+    while(low < high)
+    {
+        const unsigned int middle = (low + high) / 2;
+        if(m_blocks[middle].last < ticks)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/**
+ * Time of the first sample of a block
+ * @param b block index (unsigned int)
+ * @return time in seconds (double)
+ */
+double CompressedSeries::blockStart(const unsigned int b) const
+{
+    return m_blocks[b].first * m_resolution;
+}
+
+/**
+ * Decodes a block
+ * @param b block index (unsigned int)
+ * @param times decoded times in seconds, appended to (std::vector<double>)
+ * @param values decoded values, appended to (std::vector<float>)
+ */
+void CompressedSeries::decodeBlock(const unsigned int b, std::vector<double>& times, std::vector<float>& values) const
+{
+    const Block& block = m_blocks[b];
+    BitReader reader(block.bits);
+    
+    int64_t ticks = (int64_t)reader.read(64);
+    uint32_t bits = (uint32_t)reader.read(32);
+    times.push_back(ticks * m_resolution);
+    values.push_back(bitsFloat(bits));
+    
+    int64_t delta = 0;
+    uint32_t previous = bits;
+    int leading = 0, trailing = 0;
+    for(unsigned int i = 1; i < block.count; i++)
+    {
+        if(reader.read(1) == 1)
+        {
+            if(reader.read(1) == 0)
+                delta += signExtend(reader.read(7), 7);
+            else if(reader.read(1) == 0)
+                delta += signExtend(reader.read(9), 9);
+            else if(reader.read(1) == 0)
+                delta += signExtend(reader.read(12), 12);
+            else
+                delta += (int64_t)reader.read(64);
+        }
+        ticks += delta;
+        
+        if(reader.read(1) == 1)
+        {
+            if(reader.read(1) == 1)
+            {
+                leading = (int)reader.read(5);
+                trailing = 32 - leading - ((int)reader.read(5) + 1);
+            }
+            const uint32_t x = (uint32_t)reader.read(32 - leading - trailing) << trailing;
+            const uint32_t last = bits;
+            bits = predict(previous, last) ^ x;
+            previous = last;
+        }
+        else
+        {
+            const uint32_t last = bits;
+            bits = predict(previous, last);
+            previous = last;
+        }
+        times.push_back(ticks * m_resolution);
+        values.push_back(bitsFloat(bits));
+    }
+}
+
+/**
+ * Decodes the samples of a time range, only the blocks overlapping it are decoded
+ * The last sample before the range and the first one after it are included as well, so that the curve reaches its edges.
+ * @param tMin start of the range in seconds (double)
+ * @param tMax end of the range in seconds (double)
+ * @param times decoded times in seconds (std::vector<double>)
+ * @param values decoded values (std::vector<float>)
+ */
+void CompressedSeries::range(const double tMin, const double tMax, std::vector<double>& times, std::vector<float>& values) const
+{
+    times.clear();
+    values.clear();
+    unsigned int b = findBlock(tMin);
+    if(b > 0)
+        b--;
+    for(; b < blocks() && blockStart(b) <= tMax; b++)
+        decodeBlock(b, times, values);
+    if(b < blocks())
+        decodeBlock(b, times, values);
+    
+    // Trims the samples beyond the neighbours of the range
+    unsigned long first = 0, last = times.size();
+    while(first + 1 < last && times[first + 1] < tMin)
+        first++;
+    while(last > first + 1 && times[last - 2] > tMax)
+        last--;
+    times.erase(times.begin() + last, times.end());
+    values.erase(values.begin() + last, values.end());
+    times.erase(times.begin(), times.begin() + first);
+    values.erase(values.begin(), values.begin() + first);
+}
@@ -0,0 +1,68 @@
+//
+//  CompressedSeries.h
+//
+//  Code_Frontiers
+//  Copyright (C) 2018  Université de Lorraine - CNRS
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef CompressedSeries_h
+#define CompressedSeries_h
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * Time series compressed in fixed-size blocks, following the Gorilla scheme:
+ * timestamps are stored as delta-of-deltas and values as the XOR with the value extrapolated from the two previous ones.
+ * Blocks are independent so that any of them can be decoded on its own.
+ */
+class CompressedSeries
+{
+public:
+    CompressedSeries(const double resolution = 1e-6, const unsigned int blockSize = 1024);
+    void push(const double t, const float value);
+    unsigned long size() const;
+    unsigned long memory() const;
+    unsigned int blocks() const;
+    unsigned int findBlock(const double t) const;
+    double blockStart(const unsigned int b) const;
+    void decodeBlock(const unsigned int b, std::vector<double>& times, std::vector<float>& values) const;
+    void range(const double tMin, const double tMax, std::vector<double>& times, std::vector<float>& values) const;
+    
+private:
+    struct Block
+    {
+        int64_t first;                                                  /**< first timestamp in ticks */
+        int64_t last;                                                   /**< last timestamp in ticks */
+        unsigned int count;                                             /**< number of samples */
+        unsigned long nbBits;                                           /**< number of bits written */
+        std::vector<uint64_t> bits;                                     /**< encoded samples */
+    };
+    
+    void write(Block& block, const uint64_t value, const unsigned int n);
+    
+    double m_resolution;                                                /**< duration of a tick in seconds */
+    unsigned int m_blockSize;                                           /**< number of samples per block */
+    unsigned long m_size;                                               /**< number of samples */
+    std::vector<Block> m_blocks;
+    int64_t m_delta;                                                    /**< last delta between timestamps of the current block */
+    uint32_t m_value;                                                   /**< last value of the current block */
+    uint32_t m_previous;                                                /**< value before the last one of the current block */
+    int m_leading;                                                      /**< leading zeros of the last meaningful XOR, -1 if none */
+    int m_trailing;                                                     /**< trailing zeros of the last meaningful XOR */
+};
+
+#endif /* CompressedSeries_h */
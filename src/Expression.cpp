@@ -0,0 +1,449 @@
+//
+//  Expression.cpp
+//
+//  Code_Frontiers
+//  Copyright (C) 2018  Université de Lorraine - CNRS
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Expression.h"
+#include <iostream>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+
+/**
+ * Largest window of avg(), in samples
+ */
+static const unsigned long MAX_WINDOW = 1 << 20;
+
+/**
+ * Expression Constructor, parses the source into a plan of instructions
+ * @param source the expression (std::string)
+ * @param nbInputs number of variables that can be referenced, including the time (unsigned int)
+ */
+Expression::Expression(const std::string& source, const unsigned int nbInputs): m_source(source), m_nbInputs(nbInputs),
+                                                                                 m_position(0), m_valid(true),
+                                                                                 m_plan(), m_registers()
+{
+    parseSum();
+    skipSpaces();
+    if(m_valid && m_position < m_source.size())
+        fail("unexpected character");
+}
+
+bool Expression::valid() const
+{
+    return m_valid;
+}
+
+/**
+ * Reports a parsing error
+ * @param message description of the error (std::string)
+ * @return -1, the invalid instruction index (int)
+ */
+int Expression::fail(const std::string& message)
+{
+    if(m_valid)
+        std::cout << "ERROR::EXPRESSION::" << message << " at " << m_position << " in \"" << m_source << "\"" << std::endl;
+    m_valid = false;
+    return -1;
+}
+
+void Expression::skipSpaces()
+{
+    while(m_position < m_source.size() && std::isspace((unsigned char)m_source[m_position]))
+        m_position++;
+}
+
+/**
+ * Consumes a character if it is the next one
+ * @param c expected character (char)
+ * @return whether it was found (bool)
+ */
+bool Expression::accept(const char c)
+{
+    skipSpaces();
+    if(m_position < m_source.size() && m_source[m_position] == c)
+    {
+        m_position++;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Applies a stateless operation to scalars, used to fold constants
+ */
+float Expression::apply(const Operation op, const float a, const float b)
+{
+    switch(op)
+    {
+        case ADD: return a + b;
+        case SUB: return a - b;
+        case MUL: return a * b;
+        case DIV: return a / b;
+        case NEG: return -a;
+        case ABS: return std::abs(a);
+        case SQRT: return std::sqrt(a);
+        case SIN: return std::sin(a);
+        case COS: return std::cos(a);
+        case EXP: return std::exp(a);
+        case LOG: return std::log(a);
+        case MIN: return std::min(a, b);
+        case MAX: return std::max(a, b);
+        default: return 0;
+    }
+}
+
+/**
+ * Appends an instruction to the plan. Stateless operations on constants are computed right away.
+ * @param op operation (Operation)
+ * @param a index of the first operand (int)
+ * @param b index of the second operand (int)
+ * @return index of the instruction holding the result (int)
+ */
+int Expression::emit(const Operation op, const int a, const int b)
+{
+    const bool stateless = op != INPUT && op != CONSTANT && op != DIFF && op != AVG;
+    if(stateless && a >= 0 && m_plan[a].op == CONSTANT && (b < 0 || m_plan[b].op == CONSTANT))
+    {
+        // Constant operands are always the last instructions
+        const float value = apply(op, m_plan[a].constant, b < 0 ? 0 : m_plan[b].constant);
+        m_plan.resize(a);
+        const int i = emit(CONSTANT);
+        m_plan[i].constant = value;
+        return i;
+    }
+    
+    Instruction instruction;
+    instruction.op = op;
+    instruction.a = a;
+    instruction.b = b;
+    instruction.input = 0;
+    instruction.constant = 0;
+    instruction.count = 0;
+    instruction.previous = 0;
+    instruction.previousTime = 0;
+    instruction.position = 0;
+    instruction.sum = 0;
+    m_plan.push_back(instruction);
+    return (int)m_plan.size() - 1;
+}
+
+/**
+ * sum := product (('+' | '-') product)*
+ */
+int Expression::parseSum()
+{
+    int r = parseProduct();
+    while(r >= 0)
+    {
+        if(accept('+'))
+        {
+            const int b = parseProduct();
+            r = b < 0 ? -1 : emit(ADD, r, b);
+        }
+        else if(accept('-'))
+        {
+            const int b = parseProduct();
+            r = b < 0 ? -1 : emit(SUB, r, b);
+        }
+        else
+            break;
+    }
+    return r;
+}
+
+/**
+ * product := unary (('*' | '/') unary)*
+ */
+int Expression::parseProduct()
+{
+    int r = parseUnary();
+    while(r >= 0)
+    {
+        if(accept('*'))
+        {
+            const int b = parseUnary();
+            r = b < 0 ? -1 : emit(MUL, r, b);
+        }
+        else if(accept('/'))
+        {
+            const int b = parseUnary();
+            r = b < 0 ? -1 : emit(DIV, r, b);
+        }
+        else
+            break;
+    }
+    return r;
+}
+
+/**
+ * unary := ('-' | '+') unary | primary
+ */
+int Expression::parseUnary()
+{
+    if(accept('-'))
+    {
+        const int a = parseUnary();
+        return a < 0 ? -1 : emit(NEG, a);
+    }
+    if(accept('+'))
+        return parseUnary();
+    return parsePrimary();
+}
+
+/**
+ * primary := number | 't' | 'x' index | function '(' arguments ')' | '(' sum ')'
+ */
+int Expression::parsePrimary()
+{
+    skipSpaces();
+    if(m_position >= m_source.size())
+        return fail("unexpected end");
+    
+    if(accept('('))
+    {
+        const int r = parseSum();
+        if(r < 0)
+            return -1;
+        return accept(')') ? r : fail("missing )");
+    }
+    
+    const char c = m_source[m_position];
+    if(std::isdigit((unsigned char)c) || c == '.')
+    {
+        const char* start = m_source.c_str() + m_position;
+        char* end;
+        const double value = std::strtod(start, &end);
+        if(end == start)
+            return fail("invalid number");
+        m_position += end - start;
+        const int r = emit(CONSTANT);
+        m_plan[r].constant = (float)value;
+        return r;
+    }
+    
+    if(!std::isalpha((unsigned char)c))
+        return fail("unexpected character");
+    const unsigned long start = m_position;
+    while(m_position < m_source.size() && std::isalnum((unsigned char)m_source[m_position]))
+        m_position++;
+    const std::string name = m_source.substr(start, m_position - start);
+    
+    if(name == "t" || (name[0] == 'x' && name.size() > 1 && name.find_first_not_of("0123456789", 1) == std::string::npos))
+    {
+        unsigned long input = 0;
+        if(name != "t")
+        {
+            errno = 0;
+            input = std::strtoul(name.c_str() + 1, 0, 10);
+            if(errno == ERANGE)
+                return fail("unknown variable " + name);
+        }
+        if(input >= m_nbInputs)
+            return fail("unknown variable " + name);
+        const int r = emit(INPUT);
+        m_plan[r].input = (unsigned int)input;
+        return r;
+    }
+    
+    static const char* names[] = {"abs", "sqrt", "sin", "cos", "exp", "log", "min", "max", "diff", "avg"};
+    static const Operation operations[] = {ABS, SQRT, SIN, COS, EXP, LOG, MIN, MAX, DIFF, AVG};
+    int f = -1;
+    for(int i = 0; i < 10; i++)
+    {
+        if(name == names[i])
+            f = i;
+    }
+    if(f < 0)
+        return fail("unknown function " + name);
+    const Operation op = operations[f];
+    
+    if(!accept('('))
+        return fail("missing (");
+    const int a = parseSum();
+    if(a < 0)
+        return -1;
+    int r;
+    if(op == MIN || op == MAX)
+    {
+        if(!accept(','))
+            return fail("missing second argument");
+        const int b = parseSum();
+        if(b < 0)
+            return -1;
+        r = emit(op, a, b);
+    }
+    else if(op == AVG)
+    {
+        if(!accept(','))
+            return fail("missing window size");
+        const int n = parseSum();
+        if(n < 0)
+            return -1;
+        const float size = m_plan[n].op == CONSTANT ? m_plan[n].constant : 0;
+        if(size < 1 || size != std::floor(size))
+            return fail("the window size must be a positive integer");
+        if(size > MAX_WINDOW)
+            return fail("the window size must not exceed " + std::to_string(MAX_WINDOW) + " samples");
+        m_plan.pop_back();
+        r = emit(AVG, a);
+        m_plan[r].window.assign((unsigned long)size, 0);
+    }
+    else
+        r = emit(op, a);
+    return accept(')') ? r : fail("missing )");
+}
+
+/**
+ * Values of an instruction over the current batch, variables are read straight from their column
+ */
+const float* Expression::result(const std::vector<std::vector<float> >& columns, const int i) const
+{
+    if(m_plan[i].op == INPUT)
+        return &columns[m_plan[i].input][0];
+    return &m_registers[i][0];
+}
+
+/**
+ * Evaluates the expression over a batch of samples
+ * Each instruction runs over the whole batch before the next one, so that the loops are simple enough to be vectorized.
+ * @param times times of the batch in double precision, from which the time steps of diff() are computed (double*)
+ * @param columns values of each variable over the batch, the first column being the time (std::vector<std::vector<float> >)
+ * @param n number of samples in the batch (unsigned long)
+ * @param out values of the expression (std::vector<float>)
+ */
+void Expression::evaluate(const double* times, const std::vector<std::vector<float> >& columns, const unsigned long n, std::vector<float>& out)
+{
+    out.resize(n);
+    if(n == 0)
+        return;
+    if(!m_valid)
+    {
+        std::fill(out.begin(), out.end(), 0.0f);
+        return;
+    }
+    
+    m_registers.resize(m_plan.size());
+    for(unsigned long i = 0; i < m_plan.size(); i++)
+    {
+        Instruction& instruction = m_plan[i];
+        if(instruction.op == INPUT)
+            continue;
+        m_registers[i].resize(n);
+        float* r = &m_registers[i][0];
+        const float* a = instruction.a >= 0 ? result(columns, instruction.a) : 0;
+        const float* b = instruction.b >= 0 ? result(columns, instruction.b) : 0;
+        
+        switch(instruction.op)
+        {
+            case CONSTANT:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = instruction.constant;
+                break;
+            case ADD:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = a[k] + b[k];
+                break;
+            case SUB:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = a[k] - b[k];
+                break;
+            case MUL:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = a[k] * b[k];
+                break;
+            case DIV:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = a[k] / b[k];
+                break;
+            case NEG:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = -a[k];
+                break;
+            case ABS:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = std::abs(a[k]);
+                break;
+            case SQRT:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = std::sqrt(a[k]);
+                break;
+            case SIN:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = std::sin(a[k]);
+                break;
+            case COS:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = std::cos(a[k]);
+                break;
+            case EXP:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = std::exp(a[k]);
+                break;
+            case LOG:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = std::log(a[k]);
+                break;
+            case MIN:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = std::min(a[k], b[k]);
+                break;
+            case MAX:
+                for(unsigned long k = 0; k < n; k++)
+                    r[k] = std::max(a[k], b[k]);
+                break;
+            case DIFF:
+            {
+                // The first sample of the batch relies on the last one of the previous batch
+                // The time steps are taken in double precision, they would vanish in float for large timestamps.
+                const float dt = (float)(times[0] - instruction.previousTime);
+                r[0] = instruction.count > 0 && dt != 0 ? (a[0] - instruction.previous) / dt : 0;
+                for(unsigned long k = 1; k < n; k++)
+                {
+                    const float dtk = (float)(times[k] - times[k - 1]);
+                    r[k] = dtk != 0 ? (a[k] - a[k - 1]) / dtk : 0;
+                }
+                instruction.previous = a[n - 1];
+                instruction.previousTime = times[n - 1];
+                instruction.count += n;
+                break;
+            }
+            case AVG:
+            {
+                // Running sum over a circular window, averaged over the samples seen so far until the window is full
+                std::vector<float>& window = instruction.window;
+                for(unsigned long k = 0; k < n; k++)
+                {
+                    instruction.sum += a[k] - window[instruction.position];
+                    window[instruction.position] = a[k];
+                    instruction.position = (instruction.position + 1) % window.size();
+                    instruction.count++;
+                    r[k] = (float)(instruction.sum / std::min(instruction.count, (unsigned long)window.size()));
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    
+    const float* r = result(columns, (int)m_plan.size() - 1);
+    out.assign(r, r + n);
+}
@@ -0,0 +1,79 @@
+//
+//  Expression.h
+//
+//  Code_Frontiers
+//  Copyright (C) 2018  Université de Lorraine - CNRS
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef Expression_h
+#define Expression_h
+
+#include <string>
+#include <vector>
+
+/**
+ * Expression over the variables of the Grapher, parsed once into a plan of instructions that are each evaluated over
+ * a whole batch of samples.
+ * Variables are written x1, x2... and the time t. Supported are + - * /, parentheses, numbers and the functions
+ * abs, sqrt, sin, cos, exp, log, min(a, b), max(a, b), diff(e) (derivative with respect to time) and avg(e, n)
+ * (moving average over the last n samples, n being at most 2^20). For instance: "x1 - x2", "avg(x3, 20)", "diff(x1) * x4".
+ * The time t is read in float precision like the variables, so expressions of t lose their resolution for large
+ * timestamps; only diff() takes its time steps in double.
+ */
+class Expression
+{
+public:
+    Expression(const std::string& source, const unsigned int nbInputs);
+    bool valid() const;
+    void evaluate(const double* times, const std::vector<std::vector<float> >& columns, const unsigned long n, std::vector<float>& out);
+    
+private:
+    enum Operation { INPUT, CONSTANT, ADD, SUB, MUL, DIV, NEG, ABS, SQRT, SIN, COS, EXP, LOG, MIN, MAX, DIFF, AVG };
+    
+    struct Instruction
+    {
+        Operation op;
+        int a, b;                                                       /**< operands, as indices of previous instructions */
+        unsigned int input;                                             /**< column read by INPUT */
+        float constant;                                                 /**< value of CONSTANT */
+        unsigned long count;                                            /**< number of samples seen by DIFF and AVG */
+        float previous;                                                 /**< last operand of DIFF */
+        double previousTime;                                            /**< time of the last operand of DIFF */
+        std::vector<float> window;                                      /**< last operands of AVG */
+        unsigned long position;                                         /**< next slot of the window of AVG */
+        double sum;                                                     /**< sum of the window of AVG */
+    };
+    
+    static float apply(const Operation op, const float a, const float b);
+    int emit(const Operation op, const int a = -1, const int b = -1);
+    int parseSum();
+    int parseProduct();
+    int parseUnary();
+    int parsePrimary();
+    void skipSpaces();
+    bool accept(const char c);
+    int fail(const std::string& message);
+    const float* result(const std::vector<std::vector<float> >& columns, const int i) const;
+    
+    std::string m_source;
+    unsigned int m_nbInputs;                                            /**< number of columns, including the time */
+    unsigned long m_position;                                           /**< parsing position in m_source */
+    bool m_valid;
+    std::vector<Instruction> m_plan;                                    /**< instructions, the last one being the result */
+    std::vector<std::vector<float> > m_registers;                       /**< result of each instruction over the current batch */
+};
+
+#endif /* Expression_h */
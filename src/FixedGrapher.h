@@ -0,0 +1,145 @@
+//
+//  FixedGrapher.h
+//
+//  Code_Frontiers
+//  Copyright (C) 2018  Université de Lorraine - CNRS
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef FixedGrapher_h
+#define FixedGrapher_h
+
+#include <array>
+#include "Grapher.h"
+
+/**
+ * Converts the samples of a frame to float, unrolled at compile time
+ */
+template<unsigned int I, unsigned int N, typename T>
+struct FrameConverter
+{
+    static void convert(const T* frame, float* values)
+    {
+        values[I] = static_cast<float>(frame[I]);
+        FrameConverter<I + 1, N, T>::convert(frame, values);
+    }
+};
+
+template<unsigned int N, typename T>
+struct FrameConverter<N, N, T>
+{
+    static void convert(const T*, float*)
+    {
+    }
+};
+
+/**
+ * Grapher for a fixed number of variables of a given sample type, e.g. int16_t ADC counts.
+ * The buffers are created once for N variables and frames are converted to float by a conversion unrolled at compile
+ * time, without going through a std::vector<double> nor checking the number of values. Only this conversion is
+ * specialized: the converted values are then appended by the Grapher like any other row, into its usual buffers.
+ * Variable i of the frame is displayed as variable i + 1, variable 0 being the time.
+ * The Grapher is inherited as protected, so that the calls that could change the number of variables, such as
+ * update(std::vector<double>) or enqueue(std::vector<double>), are not reachable. Frames are enqueued from the
+ * simulation thread with enqueue(t, frame) instead while run() services the window.
+ */
+template<unsigned int N, typename T = double>
+class FixedGrapher: protected Grapher
+{
+    static_assert(N > 0, "FixedGrapher needs at least one variable");
+    
+public:
+    using Grapher::render0;
+    using Grapher::render1;
+    using Grapher::render2;
+    using Grapher::render3;
+    using Grapher::setDisplayedVariables;
+    using Grapher::idle;
+    using Grapher::run;
+    using Grapher::requestRedraw;
+    using Grapher::setFrameRate;
+    using Grapher::setIconified;
+    using Grapher::shouldClose;
+    using Grapher::setBoundariesX;
+    using Grapher::setBoundariesY;
+    using Grapher::zoom;
+    using Grapher::pan;
+    using Grapher::resetView;
+    using Grapher::cursorToView;
+    using Grapher::setCompressedHistory;
+    using Grapher::exportHistory;
+    using Grapher::addDerivedVariable;
+    using Grapher::V_WIDTH;
+    using Grapher::V_HEIGHT;
+    using Grapher::_Window;
+    
+    /**
+     * FixedGrapher Constructor
+     * @see Grapher(const unsigned int width, const unsigned int height, const double tMax, const double dt, const unsigned int nbVariables)
+     */
+    FixedGrapher(const unsigned int width, const unsigned int height, const double tMax = -1, const double dt = 0.05):
+        Grapher(width, height, tMax, dt, N + 1)
+    {
+    }
+    
+    /**
+     * Updates the Buffers with a new frame
+     * @param t time of the frame in seconds, kept in double precision (double)
+     * @param frame the N values of the frame (T*)
+     */
+    void update(const double t, const T* frame)
+    {
+        float values[N];
+        FrameConverter<0, N, T>::convert(frame, values);
+        appendRows(&t, values, 1);
+        updateBuffers();
+    }
+    
+    void update(const double t, const std::array<T, N>& frame)
+    {
+        update(t, frame.data());
+    }
+    
+    /**
+     * Updates the Buffers with a new frame and draws it
+     * @param t time of the frame in seconds (double)
+     * @param frame the N values of the frame (std::array<T, N>)
+     * @param shader Shader to be used (Shader)
+     */
+    void step(const double t, const std::array<T, N>& frame, const Shader& shader)
+    {
+        glfwPollEvents();
+        update(t, frame.data());
+        drawFrame(shader);
+    }
+    
+    /**
+     * Enqueues a new frame to be drawn by idle() or run(). This can be called from the simulation thread.
+     * @param t time of the frame in seconds (double)
+     * @param frame the N values of the frame (std::array<T, N>)
+     * @see Grapher::enqueue(std::vector<double> values)
+     */
+    void enqueue(const double t, const std::array<T, N>& frame)
+    {
+        // The row always holds the N + 1 values the Grapher was created with, so it is drawn without resizing.
+        std::vector<double> row(N + 1);
+        row[0] = t;
+        for(unsigned int i = 0; i < N; i++)
+            row[i + 1] = static_cast<double>(frame[i]);
+        Grapher::enqueue(row);
+    }
+};
+
+#endif /* FixedGrapher_h */
@@ -26,17 +26,34 @@
 #   define _LINUX
 #endif
 #include "Grapher.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
 
 #define OVERVIEW
 
+/**
+ * Orders vertices by abscissa for binary searches
+ */
+struct CompareX
+{
+    bool operator()(const glm::vec2& v, const double x) const { return v.x < x; }
+    bool operator()(const double x, const glm::vec2& v) const { return x < v.x; }
+};
+
 /**
  * Grapher Constructor
  * @see Grapher(const unsigned int nbVariables)
  */
 Grapher::Grapher(): m_t(0), m_dt(0.05), m_tMax(-1),
                     m_adaptiveTime(false), m_record(), m_values(),
-                    m_VAO(), m_VBO(), m_nbVariables(0)
+                    m_VAO(), m_VBO(), m_nbVariables(0), m_nbInputs(0),
+                    m_dirty(true), m_iconified(false), m_lastFrame(0), m_frameInterval(1.0 / 60),
+                    m_scrolling(false), m_decimatedVAO(0), m_decimatedVBO(0), m_dragging(false),
+                    m_compressed(false), m_resolution(1e-6)
 {
+    resetView();
 }
 
 /**
@@ -49,7 +66,12 @@ Grapher::Grapher(const unsigned int width, const unsigned int height,
                                                                      m_adaptiveTime(false),
                                                                      m_record(), m_values(),
                                                                      m_VAO(), m_VBO(), m_nbVariables(nbVariables),
-                                                                     m_multipleDisplay(false)
+                                                                     m_nbInputs(nbVariables),
+                                                                     m_multipleDisplay(false), m_dirty(true),
+                                                                     m_iconified(false), m_lastFrame(0),
+                                                                     m_frameInterval(1.0 / 60), m_scrolling(false),
+                                                                     m_decimatedVAO(0), m_decimatedVBO(0), m_dragging(false),
+                                                                     m_compressed(false), m_resolution(1e-6)
 {
     if (!glfwInit())
     {
@@ -80,7 +102,13 @@ Grapher::Grapher(const unsigned int width, const unsigned int height,
     glewInit();
 #endif
     
+    glfwSetWindowUserPointer(_Window, this);
     glfwSetKeyCallback(_Window, key_callback);
+    glfwSetWindowRefreshCallback(_Window, refresh_callback);
+    glfwSetWindowIconifyCallback(_Window, iconify_callback);
+    glfwSetScrollCallback(_Window, scroll_callback);
+    glfwSetMouseButtonCallback(_Window, mouse_button_callback);
+    glfwSetCursorPosCallback(_Window, cursor_position_callback);
     
 #ifdef _LINUX
     glViewport(0, 0, width, height);
@@ -111,8 +139,14 @@ Grapher::Grapher(const unsigned int width, const unsigned int height,
     m_VAO = std::vector<GLuint>(m_nbVariables, -1);
     m_VBO = std::vector<GLuint>(m_nbVariables, -1);
     m_values.resize(m_nbVariables);
+    m_pyramids = std::vector<MinMaxPyramid>(m_nbVariables);
+    m_history = std::vector<CompressedSeries>(m_nbVariables, CompressedSeries(m_resolution));
+    m_capacity = std::vector<unsigned long>(m_nbVariables, 0);
+    m_uploaded = std::vector<unsigned long>(m_nbVariables, 0);
     m_maxValues = std::vector<double>(m_nbVariables, 0.001);
     m_displayVariables = std::vector<std::vector<unsigned int>>(4);
+    resetView();
+    bindFramebuffer();
     bindBuffers();
 }
 
@@ -126,7 +160,10 @@ Grapher::~Grapher()
         glDeleteVertexArrays(1, &m_VAO[i]);
         glDeleteBuffers(1, &m_VBO[i]);
     }
+    glDeleteVertexArrays(1, &m_decimatedVAO);
+    glDeleteBuffers(1, &m_decimatedVBO);
     glDeleteFramebuffers(1, &m_FBO);
+    glDeleteTextures(1, &m_texture);
     
     glfwTerminate();
     
@@ -138,9 +175,9 @@ Grapher::~Grapher()
 }
 
 /**
- * Set up and Bind the Buffers
+ * Set up the Framebuffer used by renderToFramebuffer(), once since it does not depend on the variables
  */
-void Grapher::bindBuffers()
+void Grapher::bindFramebuffer()
 {
     glGenFramebuffers(1, &m_FBO);
     glGenTextures(1, &m_texture);
@@ -177,31 +214,63 @@ void Grapher::bindBuffers()
             std::cout << "Type is not Supported" << std::endl;
             break;
     }
-    
-    
+}
+
+/**
+ * Set up and Bind the Buffers
+ */
+void Grapher::bindBuffers()
+{
     for(unsigned int i = 0; i < m_nbVariables; i++)
     {
         glGenVertexArrays(1, &m_VAO[i]);
         glBindVertexArray(m_VAO[i]);
         glGenBuffers(1, &m_VBO[i]);
         glBindBuffer(GL_ARRAY_BUFFER, m_VBO[i]);
-        // We're using GL_STREAM_DRAW since each render is different
-        glBufferData(GL_ARRAY_BUFFER, 0, &m_values[i][0], GL_STREAM_DRAW);
+        // We're using GL_DYNAMIC_DRAW since new values are appended to the buffer at each update
+        glBufferData(GL_ARRAY_BUFFER, 0, 0, GL_DYNAMIC_DRAW);
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_TRUE, 0, 0);
         glEnableVertexAttribArray(0);
     }
+    
+    if(m_decimatedVAO == 0)
+    {
+        // Shared buffer receiving the decimated envelope of the curve being drawn when zoomed out
+        glGenVertexArrays(1, &m_decimatedVAO);
+        glBindVertexArray(m_decimatedVAO);
+        glGenBuffers(1, &m_decimatedVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_decimatedVBO);
+        glBufferData(GL_ARRAY_BUFFER, 0, 0, GL_STREAM_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_TRUE, 0, 0);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+    }
 }
 
 /**
  * Updates the Buffers with the new Values
+ * Only the values appended since the last upload are sent, unless the buffer has to grow or older values were modified.
  * @see update(std::vector<double> data)
  */
 void Grapher::updateBuffers()
 {
     for(unsigned int i = 0; i < m_nbVariables; i++)
     {
+        const unsigned long size = m_values[i].size();
+        if(size == 0 || m_uploaded[i] == size)
+            continue;
         glBindBuffer(GL_ARRAY_BUFFER, m_VBO[i]);
-        glBufferData(GL_ARRAY_BUFFER, m_values[i].size() * sizeof(glm::vec2), &m_values[i][0], GL_STREAM_DRAW);
+        if(size > m_capacity[i])
+        {
+            // The capacity is doubled so that the whole history is only copied a logarithmic number of times.
+            m_capacity[i] = std::max(size, std::max(2 * m_capacity[i], 1024ul));
+            glBufferData(GL_ARRAY_BUFFER, m_capacity[i] * sizeof(glm::vec2), 0, GL_DYNAMIC_DRAW);
+            m_uploaded[i] = 0;
+        }
+        if(m_uploaded[i] > size)
+            m_uploaded[i] = 0;
+        glBufferSubData(GL_ARRAY_BUFFER, m_uploaded[i] * sizeof(glm::vec2), (size - m_uploaded[i]) * sizeof(glm::vec2), &m_values[i][m_uploaded[i]]);
+        m_uploaded[i] = size;
     }
 }
 
@@ -212,60 +281,164 @@ void Grapher::updateBuffers()
  */
 void Grapher::update(std::vector<double> data)
 {
-    if(data.size() != m_nbVariables)
+    append(data);
+    updateBuffers();
+}
+
+/**
+ * Adds the new Values to the rendering format without uploading them
+ * @param data the new data sent by the simulation to be added (std::vector<double>)
+ * @see update(std::vector<double> data)
+ */
+void Grapher::append(const std::vector<double>& data)
+{
+    if(data.size() != m_nbInputs)
     {
+        // The derived variables were checked against the current inputs, they may not be read past them.
+        if(!m_derived.empty())
+        {
+            std::cout << "WARNING::Row of " << (int)data.size() << " values ignored, the derived variables expect " << m_nbInputs << std::endl;
+            return;
+        }
 	std::cout << "WARNING:: Updating variable number to " << (int)data.size() << std::endl;
-        m_nbVariables = (int)data.size();
-        m_VAO = std::vector<GLuint>(m_nbVariables, -1);
-        m_VBO = std::vector<GLuint>(m_nbVariables, -1);
-        m_values.resize(m_nbVariables);
-        m_maxValues = std::vector<double>(m_nbVariables, 0.01);
-        bindBuffers();
-    }
-    std::vector<double> scale(m_nbVariables);
-    std::vector<unsigned int> indices;
+        m_nbInputs = (unsigned int)data.size();
+        resize(m_nbInputs + (unsigned int)m_derived.size());
+    }
+    if(data.empty())
+        return;
+    // The time is kept in double precision, only the values are converted to float.
+    const double t = data[0];
+    m_row.assign(data.begin() + 1, data.end());
+    appendRows(&t, m_row.data(), 1);
+}
+
+/**
+ * Adds a batch of new Values to the rendering format without uploading them, and computes the derived variables
+ * @param times time of each row in seconds (double*)
+ * @param values n rows of the m_nbInputs - 1 values following the time (float*)
+ * @param n number of rows (unsigned long)
+ * @see addDerivedVariable(const std::string& expression)
+ */
+void Grapher::appendRows(const double* times, const float* values, const unsigned long n)
+{
+    const unsigned int inputs = m_nbInputs - 1, width = m_nbVariables - 1;
+    if(m_derived.empty())
+    {
+        for(unsigned long k = 0; k < n; k++)
+            appendRow(times[k], values + k * inputs);
+        return;
+    }
+    
+    // The batch is transposed so that each derived variable is evaluated over whole columns.
+    // Like the variables, the time column read by t is in float, only diff() gets the double times.
+    m_columns.resize(m_nbInputs);
+    m_columns[0].resize(n);
+    for(unsigned long k = 0; k < n; k++)
+        m_columns[0][k] = (float)times[k];
+    for(unsigned int i = 1; i < m_nbInputs; i++)
+    {
+        m_columns[i].resize(n);
+        for(unsigned long k = 0; k < n; k++)
+            m_columns[i][k] = values[k * inputs + i - 1];
+    }
+    // The derived values then complete the rows, so that they are drawn like any other variable.
+    m_batch.resize(n * width);
+    for(unsigned long k = 0; k < n; k++)
+        std::copy(values + k * inputs, values + (k + 1) * inputs, m_batch.begin() + k * width);
+    for(unsigned int d = 0; d < m_derived.size(); d++)
+    {
+        m_derived[d].evaluate(times, m_columns, n, m_derivedValues);
+        for(unsigned long k = 0; k < n; k++)
+            m_batch[k * width + inputs + d] = m_derivedValues[k];
+    }
+    for(unsigned long k = 0; k < n; k++)
+        appendRow(times[k], &m_batch[k * width]);
+}
+
+/**
+ * Adds a variable computed from the others each time new Values are added
+ * The expression is parsed once and then evaluated over each batch of values, see Expression for its syntax.
+ * The variables it refers to must already exist, and derived variables are not computed from single variable samples.
+ * From then on the number of input variables is fixed, rows of another size are ignored.
+ * @param expression expression of the variable, e.g. "x1 - x2" or "avg(x3, 20)" (std::string)
+ * @return index of the new variable, 0 if the expression is invalid (unsigned int)
+ */
+unsigned int Grapher::addDerivedVariable(const std::string& expression)
+{
+    Expression derived(expression, m_nbInputs);
+    if(!derived.valid())
+        return 0;
+    m_derived.push_back(derived);
+    resize(m_nbVariables + 1);
+    return m_nbVariables - 1;
+}
+
+/**
+ * Changes the number of variables, the values already recorded are kept
+ * @param nbVariables new number of variables, including the time (unsigned int)
+ */
+void Grapher::resize(const unsigned int nbVariables)
+{
+    for(unsigned int i = 0; i < m_nbVariables; i++)
+    {
+        glDeleteVertexArrays(1, &m_VAO[i]);
+        glDeleteBuffers(1, &m_VBO[i]);
+    }
+    m_nbVariables = nbVariables;
+    m_VAO = std::vector<GLuint>(m_nbVariables, -1);
+    m_VBO = std::vector<GLuint>(m_nbVariables, -1);
+    m_values.resize(m_nbVariables);
+    m_pyramids.resize(m_nbVariables, MinMaxPyramid(m_compressed ? 16 : 8));
+    m_history.resize(m_nbVariables, CompressedSeries(m_resolution));
+    m_capacity = std::vector<unsigned long>(m_nbVariables, 0);
+    m_uploaded = std::vector<unsigned long>(m_nbVariables, 0);
+    m_maxValues.resize(m_nbVariables, 0.01);
+    bindBuffers();
+}
+
+/**
+ * Adds the new Values to the rendering format without uploading them nor checking their number
+ * @param t time of the values in seconds (double)
+ * @param values one value per variable except the time, m_nbVariables - 1 values in total (float*)
+ * @see append(const std::vector<double>& data)
+ */
+void Grapher::appendRow(const double t, const float* values)
+{
     for(unsigned int i = 1; i < m_nbVariables; i++)
     {
-        if(std::abs(data[i]) > m_maxValues[i])
-        {
-            scale[i] = std::abs(data[i]);
-            indices.push_back(i);
-        }
-        else
-            scale[i] = m_maxValues[i];
-        
+        glm::vec2 point;
         if(!m_adaptiveTime)
         {
             if(m_boundariesY[0] == -1)
-                m_values[i].push_back(glm::vec2(2 * (data[0] - m_boundariesX[0]) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0, data[i]/ m_maxValues[i]));
+                point = glm::vec2(2 * (t - m_boundariesX[0]) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0, values[i - 1]/ m_maxValues[i]);
             else
-                m_values[i].push_back(glm::vec2(2 * (data[0] - m_boundariesX[0]) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0, 2 * (data[i] - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0));
+                point = glm::vec2(2 * (t - m_boundariesX[0]) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0, 2 * (values[i - 1] - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0);
         }
         else
         {
             if(m_boundariesY[0] == -1)
-                m_values[i].push_back(glm::vec2(data[0] - 1.0, data[i]/ m_maxValues[i]));
+                point = glm::vec2(t - 1.0, values[i - 1]/ m_maxValues[i]);
             else if(m_t > m_boundariesX[1])
             {
+                // Only the displayed values are kept from now on, they are few enough to be drawn without decimation.
+                m_scrolling = true;
                 for(unsigned int i = 1; i < m_nbVariables; i++)
                 {
+                    m_pyramids[i].clear();
+                    m_uploaded[i] = 0;
                     // For space and efficiency's sake, the values are progressively erased so that only the ones displayed are stored.
                     m_values[i].erase(m_values[i].begin(), m_values[i].begin() + 1);
                     // All values are moved one step to the left. This is the moving motion.
                     for(unsigned long v = m_values[i].size(); v > 0; v--)
                         m_values[i][v] -= glm::vec2(2 * m_dt / (m_boundariesX[1] - m_boundariesX[0]), 0);
                 }
-                m_values[i].push_back(glm::vec2(2 * (data[0] - m_boundariesX[0] - (m_t - m_boundariesX[1])) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0, 2 * (data[i] - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0));
+                point = glm::vec2(2 * (t - m_boundariesX[0] - (m_t - m_boundariesX[1])) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0, 2 * (values[i - 1] - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0);
             }
             else
-                m_values[i].push_back(glm::vec2(2 * (data[0] - m_boundariesX[0]) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0, 2 * (data[i] - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0));
-                //m_values[i].push_back(glm::vec2(data[0] - 1.0, 2 * (data[i] - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0));
+                point = glm::vec2(2 * (t - m_boundariesX[0]) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0, 2 * (values[i - 1] - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0);
+                //point = glm::vec2(t - 1.0, 2 * (values[i - 1] - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0);
         }
-
-        if(m_t > 0)
-            m_values[i].push_back(m_values[i].back());
-        // Each value (except for the first) is stored twice so that we can render lines. This is not necessary if you only wish to render points.
-        m_record.push_back(data[i]);
+        appendVertex(i, point, t, values[i - 1]);
     }
     // Once the curve fills the three quarters of the screen, it moves to the left with time so that it keeps beeing displayed online.
 //    if(m_adaptiveTime)
@@ -283,16 +456,186 @@ void Grapher::update(std::vector<double> data)
 //            }
 //        }
 //    }
-    if(m_boundariesY[0] == -1)
+    m_t += m_dt;
+    m_dirty = true;
+}
+
+/**
+ * Adds a sample of a variable to the rendering format, the history and the envelopes
+ * @param var index of the variable (unsigned int)
+ * @param point the sample in rendering coordinates (glm::vec2)
+ * @param t time of the sample in seconds (double)
+ * @param value value of the sample (double)
+ * @see appendRow(const float* data)
+ */
+void Grapher::appendVertex(const unsigned int var, const glm::vec2& point, const double t, const double value)
+{
+    std::vector<glm::vec2>& values = m_values[var];
+    // Each value (except for the first) is stored twice so that we can render lines. This is not necessary if you only wish to render points.
+    const bool first = values.empty();
+    values.push_back(point);
+    if(!m_scrolling)
+        m_pyramids[var].push(point);
+    if(!first)
+        values.push_back(point);
+    
+    if(m_compressed)
     {
-        for(unsigned int i: indices)
+        m_history[var].push(t, value);
+        // Older values are dropped from the rendering format, an even number of vertices at a time to keep segments paired.
+        const unsigned long tail = 2048;
+        if(!m_scrolling && values.size() > 2 * tail)
         {
-            for(unsigned int j = 0; j < m_values[i].size(); j++)
-                m_values[i][j].y *= m_maxValues[i] / scale[i];
+            values.erase(values.begin(), values.begin() + ((values.size() - tail) & ~1ul));
+            m_uploaded[var] = 0;
         }
     }
-    m_maxValues = scale;
-    m_t += m_dt;
+    else
+        m_record.push_back(value);
+    
+    // Non finite values would flatten every other one
+    if(std::isfinite(value) && std::abs(value) > m_maxValues[var])
+    {
+        if(m_boundariesY[0] == -1)
+        {
+            const double scale = m_maxValues[var] / std::abs(value);
+            for(unsigned int j = 0; j < values.size(); j++)
+                values[j].y *= scale;
+            m_pyramids[var].scaleY(scale);
+            m_uploaded[var] = 0;
+        }
+        m_maxValues[var] = std::abs(value);
+    }
+}
+
+/**
+ * Adds a sample of a single variable with its own timestamp, without uploading it
+ * Variables sampled at different rates share the time axis. Samples are ignored once the curves scroll to the left,
+ * since each row then shifts and erases the vertices of every variable, which the samples do not follow.
+ * @param var index of the variable, starting at 1, it must be one of the input variables (unsigned int)
+ * @param t time of the sample in seconds, must not be smaller than the previous one of this variable (double)
+ * @param value value of the sample (double)
+ * @see update(const unsigned int var, const double t, const double value)
+ */
+void Grapher::appendSample(const unsigned int var, const double t, const double value)
+{
+    // The time is not a variable, and the derived ones are only computed from complete rows.
+    if(var == 0 || var >= m_nbInputs)
+    {
+        std::cout << "WARNING::Sample of unknown variable " << var << " ignored" << std::endl;
+        return;
+    }
+    if(m_scrolling)
+    {
+        std::cout << "WARNING::Sample of variable " << var << " ignored in the scrolling mode" << std::endl;
+        return;
+    }
+    appendVertex(var, vertex(var, t, value), t, value);
+    m_dirty = true;
+}
+
+/**
+ * Updates the Buffers with a new sample of a single variable
+ * @param var index of the variable, starting at 1 (unsigned int)
+ * @param t time of the sample in seconds (double)
+ * @param value value of the sample (double)
+ * @see update(const unsigned int var, const std::vector<double>& times, const std::vector<double>& values)
+ */
+void Grapher::update(const unsigned int var, const double t, const double value)
+{
+    appendSample(var, t, value);
+    updateBuffers();
+}
+
+/**
+ * Updates the Buffers with a batch of samples of a single variable, they are uploaded once
+ * @param var index of the variable, starting at 1 (unsigned int)
+ * @param times times of the samples in seconds, in increasing order (std::vector<double>)
+ * @param values values of the samples (std::vector<double>)
+ * @see update(const unsigned int var, const double t, const double value)
+ */
+void Grapher::update(const unsigned int var, const std::vector<double>& times, const std::vector<double>& values)
+{
+    for(unsigned long k = 0; k < times.size() && k < values.size(); k++)
+        appendSample(var, times[k], values[k]);
+    updateBuffers();
+}
+
+/**
+ * Enqueues new Values to be drawn by idle() or run(). This can be called from the simulation thread.
+ * @param values the new data sent by the simulation to be added (std::vector<double>)
+ * @see run(const Shader& shader, const double timeout)
+ */
+void Grapher::enqueue(std::vector<double> values)
+{
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        wasEmpty = m_queue.empty();
+        Entry entry = {0, 0.0, 0.0, std::move(values)};
+        m_queue.push_back(entry);
+    }
+    // Only the first pending row wakes the window up, the following ones are drained along with it.
+    if(wasEmpty)
+        glfwPostEmptyEvent();
+}
+
+/**
+ * Enqueues a sample of a single variable to be drawn by idle() or run(). This can be called from the simulation thread.
+ * @param var index of the variable, starting at 1 (unsigned int)
+ * @param t time of the sample in seconds (double)
+ * @param value value of the sample (double)
+ * @see update(const unsigned int var, const double t, const double value)
+ */
+void Grapher::enqueue(const unsigned int var, const double t, const double value)
+{
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        wasEmpty = m_queue.empty();
+        Entry entry = {var, t, value, std::vector<double>()};
+        m_queue.push_back(entry);
+    }
+    if(wasEmpty)
+        glfwPostEmptyEvent();
+}
+
+/**
+ * Moves the enqueued Values to the rendering format and uploads them once
+ * @see enqueue(std::vector<double> values)
+ */
+void Grapher::flush()
+{
+    std::vector<Entry> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        pending.swap(m_queue);
+    }
+    if(pending.empty())
+        return;
+    // Entries are applied in their arrival order, consecutive rows being appended as a single batch
+    std::vector<double> times;
+    std::vector<float> batch;
+    for(const Entry& entry: pending)
+    {
+        const std::vector<double>& values = entry.values;
+        if(entry.var == 0 && values.size() == m_nbInputs && !values.empty())
+        {
+            times.push_back(values[0]);
+            batch.insert(batch.end(), values.begin() + 1, values.end());
+            continue;
+        }
+        if(!times.empty())
+            appendRows(times.data(), batch.data(), times.size());
+        times.clear();
+        batch.clear();
+        if(entry.var == 0)
+            append(values);
+        else
+            appendSample(entry.var, entry.t, entry.value);
+    }
+    if(!times.empty())
+        appendRows(times.data(), batch.data(), times.size());
     updateBuffers();
 }
 
@@ -301,6 +644,7 @@ void Grapher::setDisplayedVariables(const unsigned int screen, std::vector<unsig
     m_displayVariables[screen] = var;
     if(screen > 0)
         m_multipleDisplay = true;
+    m_dirty = true;
 }
 
 void savePPM(std::string filename, unsigned char* pixels)
@@ -329,10 +673,90 @@ void savePPM(std::string filename, unsigned char* pixels)
 void Grapher::step(std::vector<double> values, const Shader& shader)
 {
     glfwPollEvents();
-    glClear(GL_COLOR_BUFFER_BIT);
-    
     update(values);
+    drawFrame(shader);
+}
+
+/**
+ * Waits for events or enqueued Values and redraws only if something visible changed
+ * @param shader Shader to be used (Shader)
+ * @param timeout maximum time to wait for an event in seconds (double)
+ * @see run(const Shader& shader, const double timeout)
+ */
+void Grapher::idle(const Shader& shader, const double timeout)
+{
+    double wait = timeout;
+    // A pending redraw only waits until the next frame is due, so that bursts of data are drawn at most once per frame.
+    if(m_dirty && !m_iconified)
+        wait = std::min(timeout, m_lastFrame + m_frameInterval - glfwGetTime());
+    if(wait > 0)
+        glfwWaitEventsTimeout(wait);
+    else
+        glfwPollEvents();
+    
+    flush();
+    
+    if(!m_dirty || m_iconified || glfwGetTime() < m_lastFrame + m_frameInterval)
+        return;
+    
+    drawFrame(shader);
+}
+
+/**
+ * Services the window until it is closed, drawing enqueued Values as they arrive
+ * @param shader Shader to be used (Shader)
+ * @param timeout maximum time to wait for an event in seconds (double)
+ * @see enqueue(std::vector<double> values)
+ */
+void Grapher::run(const Shader& shader, const double timeout)
+{
+    while(!shouldClose())
+        idle(shader, timeout);
+}
+
+/**
+ * Marks the window as needing to be redrawn on the next idle()
+ */
+void Grapher::requestRedraw()
+{
+    m_dirty = true;
+}
+
+/**
+ * Sets the maximum frame rate of idle()
+ * @param fps maximum number of frames per second (double)
+ */
+void Grapher::setFrameRate(const double fps)
+{
+    m_frameInterval = 1.0 / fps;
+}
+
+void Grapher::setIconified(const bool iconified)
+{
+    m_iconified = iconified;
+    m_dirty = true;
+}
+
+/**
+ * Clears the window, renders every Viewport and swaps the buffers
+ * @param shader Shader to be used (Shader)
+ */
+void Grapher::drawFrame(const Shader& shader)
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    render(shader);
     
+    glfwSwapBuffers(_Window);
+    m_lastFrame = glfwGetTime();
+    m_dirty = false;
+}
+
+/**
+ * Render every Viewport
+ * @param shader Shader to be used (Shader)
+ */
+void Grapher::render(const Shader& shader) const
+{
     if(m_multipleDisplay)
     {
         glViewport(0, 0, V_WIDTH, V_HEIGHT);
@@ -349,8 +773,6 @@ void Grapher::step(std::vector<double> values, const Shader& shader)
     }
     else
         render0(shader);
-    
-    glfwSwapBuffers(_Window);
 }
 
 int countF = 0;
@@ -364,23 +786,7 @@ void Grapher::renderToFramebuffer(const std::string& path, std::vector<double> v
     glClear(GL_COLOR_BUFFER_BIT);
     
     update(values);
-    
-    if(m_multipleDisplay)
-    {
-        glViewport(0, 0, V_WIDTH, V_HEIGHT);
-        render0(shader);
-        
-        glViewport(0, V_HEIGHT, V_WIDTH, V_HEIGHT);
-        render1(shader);
-        
-        glViewport(V_WIDTH, V_HEIGHT, V_WIDTH, V_HEIGHT);
-        render2(shader);
-        
-        glViewport(V_WIDTH, 0, V_WIDTH, V_HEIGHT);
-        render3(shader);
-    }
-    else
-        render0(shader);
+    render(shader);
     
     unsigned char* pixels = new unsigned char[V_WIDTH * V_HEIGHT * 3];
     memset(pixels, 0, V_WIDTH * V_HEIGHT * 3);
@@ -407,6 +813,7 @@ void Grapher::render0(const Shader& shader) const
     if(m_nbVariables < 1 || m_displayVariables[0].size() < 1)
         return;
     shader.use();
+    glUniform4f(glGetUniformLocation(shader.m_program, "view"), m_view[0], m_view[1], m_view[2], m_view[3]);
     
     int c = 1;
 //    if (m_values[1].size() > 55)
@@ -415,11 +822,9 @@ void Grapher::render0(const Shader& shader) const
     {
         // Sets the curve color (0 is for blue, 1 is for red, 2 for green, 3 for purple)
         glUniform1i(glGetUniformLocation(shader.m_program, "c"), c++);
-        glBindVertexArray(m_VAO[var]);
         // This function is broken on Mac so don't even bother playing with it. Works with Linux though
         glPointSize(5);
-        glDrawArrays(GL_LINES, 0, int(m_values[var].size()));
-        glBindVertexArray(0);
+        drawVariable(var);
     }
 }
 
@@ -435,16 +840,15 @@ void Grapher::render1(const Shader& shader) const
     if(m_nbVariables < 1 || m_displayVariables[1].size() < 1)
         return;
     shader.use();
+    glUniform4f(glGetUniformLocation(shader.m_program, "view"), m_view[0], m_view[1], m_view[2], m_view[3]);
     int c = 0;
     for(int var: m_displayVariables[1])
     {
         // Sets the curve color (0 is for blue, 1 is for red, 2 for green, 3 for purple)
         glUniform1i(glGetUniformLocation(shader.m_program, "c"), c++);
-        glBindVertexArray(m_VAO[var]);
         // This function is broken on Mac so don't even bother playing with it. Works with Linux though
         glPointSize(5);
-        glDrawArrays(GL_LINES, 0, int(m_values[var].size()));
-        glBindVertexArray(0);
+        drawVariable(var);
     }
 }
 
@@ -460,16 +864,15 @@ void Grapher::render2(const Shader& shader) const
     if(m_nbVariables < 1 || m_displayVariables[2].size() < 1)
         return;
     shader.use();
+    glUniform4f(glGetUniformLocation(shader.m_program, "view"), m_view[0], m_view[1], m_view[2], m_view[3]);
     int c = 0;
     for(int var: m_displayVariables[2])
     {
         // Sets the curve color (0 is for blue, 1 is for red, 2 for green, 3 for purple)
         glUniform1i(glGetUniformLocation(shader.m_program, "c"), c++);
-        glBindVertexArray(m_VAO[var]);
         // This function is broken on Mac so don't even bother playing with it. Works with Linux though
         glPointSize(5);
-        glDrawArrays(GL_LINES, 0, int(m_values[var].size()));
-        glBindVertexArray(0);
+        drawVariable(var);
     }
 }
 
@@ -485,17 +888,282 @@ void Grapher::render3(const Shader& shader) const
     if(m_nbVariables < 1 || m_displayVariables[3].size() < 1)
         return;
     shader.use();
+    glUniform4f(glGetUniformLocation(shader.m_program, "view"), m_view[0], m_view[1], m_view[2], m_view[3]);
     int c = 0;
     for(int var: m_displayVariables[3])
     {
         // Sets the curve color (0 is for blue, 1 is for red, 2 for green, 3 for purple)
         glUniform1i(glGetUniformLocation(shader.m_program, "c"), c++);
-        glBindVertexArray(m_VAO[var]);
         // This function is broken on Mac so don't even bother playing with it. Works with Linux though
         glPointSize(5);
-        glDrawArrays(GL_LINES, 0, int(m_values[var].size()));
-        glBindVertexArray(0);
+        drawVariable(var);
+    }
+}
+
+/**
+ * Finds the vertices of a curve or of an envelope that lie in a horizontal range
+ * Vertices come in pairs sorted by x, the pairs overlapping the edges of the range are included.
+ * @param vertices segments or buckets (std::vector<glm::vec2>)
+ * @param xMin start of the range (double)
+ * @param xMax end of the range (double)
+ * @param first index of the first vertex in the range (unsigned long)
+ * @param last index following the last vertex in the range (unsigned long)
+ */
+static void visibleRange(const std::vector<glm::vec2>& vertices, const double xMin, const double xMax, unsigned long& first, unsigned long& last)
+{
+    first = std::lower_bound(vertices.begin(), vertices.end(), xMin, CompareX()) - vertices.begin();
+    last = std::upper_bound(vertices.begin(), vertices.end(), xMax, CompareX()) - vertices.begin();
+    first = first > 0 ? (first - 1) & ~1ul : 0;
+    last = std::min((last + 2) & ~1ul, (unsigned long)vertices.size());
+}
+
+/**
+ * Draws the part of a curve that lies in the visible range
+ * The visible vertices are found by binary search. When there are more segments than pixels, the envelope of the
+ * finest sufficient level of the MinMaxPyramid is drawn instead.
+ * @param var index of the variable (unsigned int)
+ */
+void Grapher::drawVariable(const unsigned int var) const
+{
+    const std::vector<glm::vec2>& values = m_values[var];
+    if(values.empty())
+        return;
+    
+    const unsigned long maxSegments = 2 * V_WIDTH;
+    const MinMaxPyramid& pyramid = m_pyramids[var];
+    unsigned long first, last;
+    visibleRange(values, m_view[0], m_view[1], first, last);
+    unsigned long visible = (last - first) / 2;
+    
+    // With a compressed history, only the most recent values are kept in the rendering format.
+    const bool history = m_compressed && !m_scrolling && m_history[var].size() * 2 > values.size() + 1 && m_view[0] < values.front().x;
+    if(history && pyramid.levels() > 0)
+    {
+        unsigned long b0, b1;
+        visibleRange(pyramid.level(0), m_view[0], m_view[1], b0, b1);
+        visible = (b1 - b0) / 2 * pyramid.bucketSize(0);
     }
+    
+    if(visible <= maxSegments || pyramid.levels() == 0)
+    {
+        if(history)
+            drawHistory(var);
+        else
+        {
+            glBindVertexArray(m_VAO[var]);
+            glDrawArrays(GL_LINES, int(first), int(last - first));
+            glBindVertexArray(0);
+        }
+        return;
+    }
+    
+    unsigned int l = 0;
+    while(l + 1 < pyramid.levels() && visible / pyramid.bucketSize(l) > maxSegments)
+        l++;
+    const std::vector<glm::vec2>& level = pyramid.level(l);
+    visibleRange(level, m_view[0], m_view[1], first, last);
+    if(last <= first)
+        return;
+    
+    glBindVertexArray(m_decimatedVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_decimatedVBO);
+    glBufferData(GL_ARRAY_BUFFER, (last - first) * sizeof(glm::vec2), &level[first], GL_STREAM_DRAW);
+    glDrawArrays(GL_LINE_STRIP, 0, int(last - first));
+    glBindVertexArray(0);
+}
+
+/**
+ * Draws the visible part of a curve from its compressed history, only the blocks in the visible range are decoded
+ * @param var index of the variable (unsigned int)
+ */
+void Grapher::drawHistory(const unsigned int var) const
+{
+    std::vector<double> times;
+    std::vector<float> samples;
+    m_history[var].range(timeAt(m_view[0]), timeAt(m_view[1]), times, samples);
+    if(times.empty())
+        return;
+    
+    std::vector<glm::vec2> strip(times.size());
+    for(unsigned long k = 0; k < times.size(); k++)
+        strip[k] = vertex(var, times[k], samples[k]);
+    
+    glBindVertexArray(m_decimatedVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_decimatedVBO);
+    glBufferData(GL_ARRAY_BUFFER, strip.size() * sizeof(glm::vec2), &strip[0], GL_STREAM_DRAW);
+    glDrawArrays(GL_LINE_STRIP, 0, int(strip.size()));
+    glBindVertexArray(0);
+}
+
+/**
+ * Converts a sample to rendering coordinates, the same way appendRow() does outside of the scrolling mode
+ * @param var index of the variable (unsigned int)
+ * @param t time in seconds (double)
+ * @param value sample value (double)
+ * @return vertex in rendering coordinates (glm::vec2)
+ */
+glm::vec2 Grapher::vertex(const unsigned int var, const double t, const double value) const
+{
+    double x, y;
+    if(m_adaptiveTime && m_boundariesY[0] == -1)
+        x = t - 1.0;
+    else
+        x = 2 * (t - m_boundariesX[0]) / (m_boundariesX[1] - m_boundariesX[0]) - 1.0;
+    if(m_boundariesY[0] == -1)
+        y = value / m_maxValues[var];
+    else
+        y = 2 * (value - m_boundariesY[0]) / (m_boundariesY[1] - m_boundariesY[0]) - 1.0;
+    return glm::vec2(x, y);
+}
+
+/**
+ * Converts an abscissa in rendering coordinates back to a time
+ * @param x abscissa in rendering coordinates (double)
+ * @return time in seconds (double)
+ * @see vertex(const unsigned int var, const double t, const double value)
+ */
+double Grapher::timeAt(const double x) const
+{
+    if(m_adaptiveTime && m_boundariesY[0] == -1)
+        return x + 1.0;
+    return m_boundariesX[0] + (x + 1.0) / 2 * (m_boundariesX[1] - m_boundariesX[0]);
+}
+
+/**
+ * Keeps the history of the values compressed instead of as raw floats. It should be set before the first update.
+ * Only the most recent values are then kept in the rendering format; older ones are decoded when they need to be
+ * drawn or exported.
+ * @param compressed whether the history should be compressed (bool)
+ * @param resolution resolution of the recorded times in seconds (double)
+ * @see exportHistory(const std::string& path, const double tMin, const double tMax)
+ */
+void Grapher::setCompressedHistory(const bool compressed, const double resolution)
+{
+    m_compressed = compressed;
+    m_resolution = resolution;
+    m_history = std::vector<CompressedSeries>(m_nbVariables, CompressedSeries(m_resolution));
+    // The history is only drawn when zoomed in, so coarser envelopes are enough and save memory.
+    m_pyramids = std::vector<MinMaxPyramid>(m_nbVariables, MinMaxPyramid(m_compressed ? 16 : 8));
+}
+
+/**
+ * Writes the compressed history of a time range to a CSV file, one line per sample
+ * @param path path of the file (std::string)
+ * @param tMin start of the range in seconds (double)
+ * @param tMax end of the range in seconds (double)
+ * @see setCompressedHistory(const bool compressed, const double resolution)
+ */
+void Grapher::exportHistory(const std::string& path, const double tMin, const double tMax) const
+{
+    if(!m_compressed)
+    {
+        std::cout << "WARNING::Only a compressed history can be exported" << std::endl;
+        return;
+    }
+    std::ofstream out(path.c_str(), std::ios::out);
+    if(!out)
+    {
+        std::cerr << "ERROR::CANNOT::OPEN::FILE" << std::endl;
+        return;
+    }
+    
+    // Enough digits for the timestamps to be read back exactly
+    out << std::setprecision(std::numeric_limits<double>::max_digits10);
+    out << "variable,time,value\n";
+    std::vector<double> times;
+    std::vector<float> samples;
+    for(unsigned int var = 1; var < m_nbVariables; var++)
+    {
+        const CompressedSeries& series = m_history[var];
+        // Blocks are decoded one at a time so that long ranges do not have to fit in memory.
+        for(unsigned int b = series.findBlock(tMin); b < series.blocks() && series.blockStart(b) <= tMax; b++)
+        {
+            times.clear();
+            samples.clear();
+            series.decodeBlock(b, times, samples);
+            for(unsigned long k = 0; k < times.size(); k++)
+            {
+                if(times[k] >= tMin && times[k] <= tMax)
+                    out << var << "," << times[k] << "," << samples[k] << "\n";
+            }
+        }
+    }
+    out.close();
+}
+
+/**
+ * Zooms the view around a fixed point
+ * @param factorX horizontal scale factor, smaller than 1 to zoom in (double)
+ * @param factorY vertical scale factor, smaller than 1 to zoom in (double)
+ * @param x abscissa of the fixed point in rendering coordinates (double)
+ * @param y ordinate of the fixed point in rendering coordinates (double)
+ * @see pan(const double dx, const double dy)
+ */
+void Grapher::zoom(const double factorX, const double factorY, const double x, const double y)
+{
+    // Below this range, float vertices can no longer be told apart
+    const double minRange = 1e-5;
+    if((m_view[1] - m_view[0]) * factorX > minRange)
+    {
+        m_view[0] = x + (m_view[0] - x) * factorX;
+        m_view[1] = x + (m_view[1] - x) * factorX;
+    }
+    if((m_view[3] - m_view[2]) * factorY > minRange)
+    {
+        m_view[2] = y + (m_view[2] - y) * factorY;
+        m_view[3] = y + (m_view[3] - y) * factorY;
+    }
+    m_dirty = true;
+}
+
+/**
+ * Moves the view
+ * @param dx horizontal displacement as a fraction of the visible range (double)
+ * @param dy vertical displacement as a fraction of the visible range (double)
+ * @see zoom(const double factorX, const double factorY, const double x, const double y)
+ */
+void Grapher::pan(const double dx, const double dy)
+{
+    const double width = m_view[1] - m_view[0], height = m_view[3] - m_view[2];
+    m_view[0] += dx * width;
+    m_view[1] += dx * width;
+    m_view[2] += dy * height;
+    m_view[3] += dy * height;
+    m_dirty = true;
+}
+
+/**
+ * Shows the whole graph again
+ */
+void Grapher::resetView()
+{
+    m_view[0] = -1;
+    m_view[1] = 1;
+    m_view[2] = -1;
+    m_view[3] = 1;
+    m_dirty = true;
+}
+
+/**
+ * Converts a cursor position to rendering coordinates
+ * @param cursorX cursor abscissa in screen coordinates (double)
+ * @param cursorY cursor ordinate in screen coordinates (double)
+ * @param x abscissa in rendering coordinates (double)
+ * @param y ordinate in rendering coordinates (double)
+ */
+void Grapher::cursorToView(const double cursorX, const double cursorY, double& x, double& y) const
+{
+    int width, height;
+    glfwGetWindowSize(_Window, &width, &height);
+    double u = cursorX / width, v = cursorY / height;
+    // With multiple displays, every viewport shares the same view so only the position inside the viewport matters.
+    if(m_multipleDisplay)
+    {
+        u = std::fmod(2 * u, 1.0);
+        v = std::fmod(2 * v, 1.0);
+    }
+    x = m_view[0] + u * (m_view[1] - m_view[0]);
+    y = m_view[3] - v * (m_view[3] - m_view[2]);
 }
 
 bool Grapher::shouldClose() const
@@ -511,6 +1179,94 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     {
         
     }
+    
+    Grapher* grapher = static_cast<Grapher*>(glfwGetWindowUserPointer(window));
+    if(!grapher || action == GLFW_RELEASE)
+        return;
+    const double x = (grapher->m_view[0] + grapher->m_view[1]) / 2, y = (grapher->m_view[2] + grapher->m_view[3]) / 2;
+    switch(key)
+    {
+        case GLFW_KEY_EQUAL:
+        case GLFW_KEY_KP_ADD:
+            grapher->zoom(0.8, 1, x, y);
+            break;
+        case GLFW_KEY_MINUS:
+        case GLFW_KEY_KP_SUBTRACT:
+            grapher->zoom(1.25, 1, x, y);
+            break;
+        case GLFW_KEY_LEFT:
+            grapher->pan(-0.1, 0);
+            break;
+        case GLFW_KEY_RIGHT:
+            grapher->pan(0.1, 0);
+            break;
+        case GLFW_KEY_UP:
+            grapher->pan(0, 0.1);
+            break;
+        case GLFW_KEY_DOWN:
+            grapher->pan(0, -0.1);
+            break;
+        case GLFW_KEY_R:
+            grapher->resetView();
+            break;
+    }
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    Grapher* grapher = static_cast<Grapher*>(glfwGetWindowUserPointer(window));
+    if(!grapher)
+        return;
+    double cursorX, cursorY, x, y;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+    grapher->cursorToView(cursorX, cursorY, x, y);
+    const double factor = std::pow(0.8, yoffset);
+    // The wheel zooms on time, and on values when shift is held
+    if(glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS)
+        grapher->zoom(1, factor, x, y);
+    else
+        grapher->zoom(factor, 1, x, y);
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    Grapher* grapher = static_cast<Grapher*>(glfwGetWindowUserPointer(window));
+    if(!grapher || button != GLFW_MOUSE_BUTTON_LEFT)
+        return;
+    grapher->m_dragging = (action == GLFW_PRESS);
+    glfwGetCursorPos(window, &grapher->m_dragX, &grapher->m_dragY);
+}
+
+void cursor_position_callback(GLFWwindow* window, double cursorX, double cursorY)
+{
+    Grapher* grapher = static_cast<Grapher*>(glfwGetWindowUserPointer(window));
+    if(!grapher || !grapher->m_dragging)
+        return;
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    if(grapher->m_multipleDisplay)
+    {
+        width /= 2;
+        height /= 2;
+    }
+    // The graph follows the cursor
+    grapher->pan((grapher->m_dragX - cursorX) / width, (cursorY - grapher->m_dragY) / height);
+    grapher->m_dragX = cursorX;
+    grapher->m_dragY = cursorY;
+}
+
+void refresh_callback(GLFWwindow* window)
+{
+    Grapher* grapher = static_cast<Grapher*>(glfwGetWindowUserPointer(window));
+    if(grapher)
+        grapher->requestRedraw();
+}
+
+void iconify_callback(GLFWwindow* window, int iconified)
+{
+    Grapher* grapher = static_cast<Grapher*>(glfwGetWindowUserPointer(window));
+    if(grapher)
+        grapher->setIconified(iconified == GL_TRUE);
 }
 
 
@@ -518,10 +1274,12 @@ void Grapher::setBoundariesX(const double xMin, const double xMax)
 {
     m_boundariesX[0] = xMin;
     m_boundariesX[1] = xMax;
+    m_dirty = true;
 }
 
 void Grapher::setBoundariesY(const double yMin, const double yMax)
 {
     m_boundariesY[0] = yMin;
     m_boundariesY[1] = yMax;
+    m_dirty = true;
 }
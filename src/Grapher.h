@@ -38,7 +38,11 @@
 
 #include <iostream>
 #include <vector>
+#include <mutex>
 #include "Shader.h"
+#include "MinMaxPyramid.h"
+#include "CompressedSeries.h"
+#include "Expression.h"
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -54,23 +58,55 @@ public:
             const double tMax = -1, const double dt = 0.05, const unsigned int nbVariables = 0);
     ~Grapher();
     void update(std::vector<double> data);
+    void update(const unsigned int var, const double t, const double value);
+    void update(const unsigned int var, const std::vector<double>& times, const std::vector<double>& values);
     void render0(const Shader& shader) const;
     void render1(const Shader& shader) const;
     void render2(const Shader& shader) const;
     void render3(const Shader& shader) const;
     void setDisplayedVariables(const unsigned int screen, std::vector<unsigned int> var);
     void step(std::vector<double> values, const Shader& shader);
+    void enqueue(std::vector<double> values);
+    void enqueue(const unsigned int var, const double t, const double value);
+    void idle(const Shader& shader, const double timeout = 0.5);
+    void run(const Shader& shader, const double timeout = 0.5);
+    void requestRedraw();
+    void setFrameRate(const double fps);
+    void setIconified(const bool iconified);
     void renderToFramebuffer(const std::string& path, std::vector<double> values, const Shader& shader);
     bool shouldClose() const;
     void setBoundariesX(const double xMin, const double xMax);
     void setBoundariesY(const double yMin, const double yMax);
+    void zoom(const double factorX, const double factorY, const double x, const double y);
+    void pan(const double dx, const double dy);
+    void resetView();
+    void cursorToView(const double cursorX, const double cursorY, double& x, double& y) const;
+    void setCompressedHistory(const bool compressed, const double resolution = 1e-6);
+    void exportHistory(const std::string& path, const double tMin, const double tMax) const;
+    unsigned int addDerivedVariable(const std::string& expression);
     
     int V_WIDTH, V_HEIGHT;
     GLFWwindow* _Window;
     
+protected:
+    void updateBuffers();
+    void appendRow(const double t, const float* values);
+    void appendRows(const double* times, const float* values, const unsigned long n);
+    void appendVertex(const unsigned int var, const glm::vec2& point, const double t, const double value);
+    void appendSample(const unsigned int var, const double t, const double value);
+    void drawFrame(const Shader& shader);
+    
 private:
+    void bindFramebuffer();
     void bindBuffers();
-    void updateBuffers();
+    void resize(const unsigned int nbVariables);
+    void append(const std::vector<double>& data);
+    void flush();
+    void render(const Shader& shader) const;
+    void drawVariable(const unsigned int var) const;
+    void drawHistory(const unsigned int var) const;
+    glm::vec2 vertex(const unsigned int var, const double t, const double value) const;
+    double timeAt(const double x) const;
     
     float m_t;                                                          /**< current time in seconds */
     float m_dt;                                                         /**< time step */
@@ -80,6 +116,7 @@ private:
     double m_boundariesY[2];
     std::vector<float> m_record;                                        /**< recorded values */
     unsigned int m_nbVariables;                                         /**< number of variables to be recorded */
+    unsigned int m_nbInputs;                                            /**< number of variables sent by the simulation, the others are derived */
     std::vector<GLuint> m_VAO;                                          /**< vector of VAOs */
     std::vector<GLuint> m_VBO;                                          /**< vector of VBOs */
     GLuint m_FBO;
@@ -89,9 +126,48 @@ private:
     std::vector<double> m_maxValues;                                    /**< maximum values */
     std::vector<std::vector<unsigned int>> m_displayVariables;          /**< variables to be displayed */
     bool m_multipleDisplay;
+    bool m_dirty;                                                       /**< something visible changed since the last frame */
+    bool m_iconified;                                                   /**< nothing is drawn while the window is iconified */
+    double m_lastFrame;                                                 /**< time at which the last frame was swapped */
+    double m_frameInterval;                                             /**< minimum time between two frames in idle mode */
+    std::mutex m_queueMutex;                                            /**< protects m_queue */
+    struct Entry
+    {
+        unsigned int var;                                               /**< variable of a single sample, 0 for a whole row */
+        double t;
+        double value;
+        std::vector<double> values;                                     /**< the whole row when var is 0 */
+    };
+    std::vector<Entry> m_queue;                                         /**< rows and samples enqueued by the simulation in their arrival order, waiting to be drawn */
+    std::vector<MinMaxPyramid> m_pyramids;                              /**< decimated envelopes of the values, drawn when zoomed out */
+    std::vector<unsigned long> m_capacity;                              /**< number of vertices each VBO can hold */
+    std::vector<unsigned long> m_uploaded;                              /**< number of vertices up to date in each VBO */
+    bool m_scrolling;                                                   /**< the oldest values are being erased as the curve moves to the left */
+    GLuint m_decimatedVAO;
+    GLuint m_decimatedVBO;
+    double m_view[4];                                                   /**< visible range (xMin, xMax, yMin, yMax) in rendering coordinates */
+    bool m_dragging;                                                    /**< the view is being dragged with the mouse */
+    double m_dragX, m_dragY;                                            /**< last cursor position while dragging */
+    std::vector<float> m_row;                                           /**< values being appended, converted to float */
+    bool m_compressed;                                                  /**< the history is kept in m_history instead of m_record */
+    double m_resolution;                                                /**< resolution of the times of the compressed history */
+    std::vector<CompressedSeries> m_history;                            /**< compressed history of each variable */
+    std::vector<Expression> m_derived;                                  /**< expressions of the derived variables, which follow the inputs */
+    std::vector<std::vector<float> > m_columns;                         /**< inputs of the current batch, one column per variable */
+    std::vector<float> m_batch;                                         /**< values of the current batch completed with the derived values */
+    std::vector<float> m_derivedValues;                                 /**< values of a derived variable over the current batch */
+    
+    friend void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
+    friend void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+    friend void cursor_position_callback(GLFWwindow* window, double cursorX, double cursorY);
 };
 
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
+void refresh_callback(GLFWwindow* window);
+void iconify_callback(GLFWwindow* window, int iconified);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void cursor_position_callback(GLFWwindow* window, double cursorX, double cursorY);
 
 #endif /* Grapher_h */
@@ -0,0 +1,119 @@
+//
+//  MinMaxPyramid.cpp
+//
+//  Code_Frontiers
+//  Copyright (C) 2018  Université de Lorraine - CNRS
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "MinMaxPyramid.h"
+#include <algorithm>
+
+/**
+ * MinMaxPyramid Constructor
+ * @param factor number of buckets of a level merged into one bucket of the next level (unsigned int)
+ */
+MinMaxPyramid::MinMaxPyramid(const unsigned int factor): m_factor(factor), m_count(0), m_levels()
+{
+}
+
+/**
+ * Adds a sample to every level
+ * @param point the new sample, its x must not be smaller than the previous one (glm::vec2)
+ */
+void MinMaxPyramid::push(const glm::vec2& point)
+{
+    // A new level is started from the buckets of the previous one as soon as they are all complete.
+    if(m_levels.empty())
+        m_levels.push_back(std::vector<glm::vec2>());
+    else if(m_count == bucketSize(levels()))
+    {
+        const std::vector<glm::vec2>& last = m_levels.back();
+        glm::vec2 low = last[0], high = last[1];
+        for(unsigned long b = 2; b < last.size(); b += 2)
+        {
+            low.y = std::min(low.y, last[b].y);
+            high.y = std::max(high.y, last[b + 1].y);
+        }
+        m_levels.push_back(std::vector<glm::vec2>());
+        m_levels.back().push_back(low);
+        m_levels.back().push_back(high);
+    }
+    
+    for(unsigned int l = 0; l < levels(); l++)
+    {
+        std::vector<glm::vec2>& level = m_levels[l];
+        if(m_count % bucketSize(l) == 0)
+        {
+            level.push_back(point);
+            level.push_back(point);
+        }
+        else
+        {
+            level[level.size() - 2].y = std::min(level[level.size() - 2].y, point.y);
+            level.back().y = std::max(level.back().y, point.y);
+        }
+    }
+    m_count++;
+}
+
+/**
+ * Rescales every level vertically
+ * @param factor positive scale factor (float)
+ */
+void MinMaxPyramid::scaleY(const float factor)
+{
+    for(std::vector<glm::vec2>& level: m_levels)
+    {
+        for(glm::vec2& v: level)
+            v.y *= factor;
+    }
+}
+
+/**
+ * Removes every sample
+ */
+void MinMaxPyramid::clear()
+{
+    m_levels.clear();
+    m_count = 0;
+}
+
+unsigned int MinMaxPyramid::levels() const
+{
+    return (unsigned int)m_levels.size();
+}
+
+/**
+ * Envelope of a level
+ * @param l level index, 0 being the finest (unsigned int)
+ * @return two vertices per bucket, (x, min) then (x, max) (std::vector<glm::vec2>)
+ */
+const std::vector<glm::vec2>& MinMaxPyramid::level(const unsigned int l) const
+{
+    return m_levels[l];
+}
+
+/**
+ * Number of samples gathered by each bucket of a level
+ * @param l level index, 0 being the finest (unsigned int)
+ */
+unsigned long MinMaxPyramid::bucketSize(const unsigned int l) const
+{
+    unsigned long size = m_factor;
+    for(unsigned int i = 0; i < l; i++)
+        size *= m_factor;
+    return size;
+}
@@ -0,0 +1,51 @@
+//
+//  MinMaxPyramid.h
+//
+//  Code_Frontiers
+//  Copyright (C) 2018  Université de Lorraine - CNRS
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef MinMaxPyramid_h
+#define MinMaxPyramid_h
+
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+/**
+ * Incremental min/max envelope of a curve at several resolutions.
+ * Each level stores two vertices per bucket, (x, min) and (x, max), so that a level can be drawn directly as a line strip.
+ * The buckets of level l gather factor^(l+1) samples.
+ */
+class MinMaxPyramid
+{
+public:
+    MinMaxPyramid(const unsigned int factor = 8);
+    void push(const glm::vec2& point);
+    void scaleY(const float factor);
+    void clear();
+    unsigned int levels() const;
+    const std::vector<glm::vec2>& level(const unsigned int l) const;
+    unsigned long bucketSize(const unsigned int l) const;
+    
+private:
+    unsigned int m_factor;                                              /**< number of buckets of a level merged into one bucket of the next level */
+    unsigned long m_count;                                              /**< number of samples pushed */
+    std::vector<std::vector<glm::vec2> > m_levels;                      /**< envelope vertices of each level */
+};
+
+#endif /* MinMaxPyramid_h */
@@ -25,7 +25,9 @@
 
 layout (location = 0) in vec2 position;
 
+uniform vec4 view;  // visible range (xMin, xMax, yMin, yMax)
+
 void main()
 {
-gl_Position = vec4(position.x, position.y, 0.0, 1.0);
+gl_Position = vec4(2.0 * (position.x - view.x) / (view.y - view.x) - 1.0, 2.0 * (position.y - view.z) / (view.w - view.z) - 1.0, 0.0, 1.0);
 }